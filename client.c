@@ -6,11 +6,32 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <errno.h>
+#include <ctype.h>
+#include <fcntl.h>
+
+#ifdef USE_TLS
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+// kTLS and SSL_OP_IGNORE_UNEXPECTED_EOF need OpenSSL 3.0. Older versions
+// (1.1.1) still work, but OpenSSL then always encrypts records itself.
+#ifdef SSL_OP_ENABLE_KTLS
+#define TLS_CTX_OPTIONS   (SSL_OP_ENABLE_KTLS | SSL_OP_IGNORE_UNEXPECTED_EOF)
+#define KTLS_SEND_ON(ssl) BIO_get_ktls_send(SSL_get_wbio(ssl))
+#define KTLS_RECV_ON(ssl) BIO_get_ktls_recv(SSL_get_rbio(ssl))
+#else
+#define TLS_CTX_OPTIONS   0
+#define KTLS_SEND_ON(ssl) 0
+#define KTLS_RECV_ON(ssl) 0
+#endif
+#endif
 
 #define SERVER_IP "127.0.0.1"      
 #define SERVER_PORT 12345       
 #define BUFFER_SIZE 1024
 #define MAX_CARDS 5
+#define MAX_PLAYERS 8
+#define MAX_NAME_LEN 32
 
 // Structure to represent a card
 typedef struct {
@@ -29,22 +50,70 @@ typedef struct {
 // Structure to represent the game state
 typedef struct {
     Player player;
-    Player opponent;
-    int your_turn;     // 1 if it's your turn, 0 otherwise
+    int num_players;
+    int health[MAX_PLAYERS];  // Health of every player, indexed by player number - 1
+    int your_index;           // Your player number - 1
+    int current_turn;         // Player number - 1 of the player whose turn it is
+    int your_turn;            // 1 if it's your turn, 0 otherwise
 } GameState;
 
+#ifdef USE_TLS
+// TLS connection to the server; NULL when TLS is disabled
+static SSL *tls_conn = NULL;
+
+// Where this client's TLS session is saved: "client_session_<NAME>.pem".
+// Empty when no client name was given, in which case nothing is saved.
+static char tls_session_file[64] = "";
+#endif
+
 // Function prototypes
 int  connect_to_server();
+int  valid_client_name(const char *name);
+#ifdef USE_TLS
+int  setup_tls(int sockfd, const char *ca_file);
+int  save_session(SSL *ssl, SSL_SESSION *session);
+int  tls_closed(SSL *ssl, int ret);
+void report_tls_error(SSL *ssl, int ret, const char *what);
+#endif
 int  receive_full_message(int sockfd, char *buffer, size_t size);
 int  send_full_message(int sockfd, const char *message);
 void receive_game_state(int sockfd, GameState *state);
 void parse_game_state(const char *msg, GameState *state);
 void display_game_state(const GameState *state);
 int  get_player_choice(const GameState *state);
-void send_player_choice(int sockfd, int choice);
+int  get_target_choice(const GameState *state);
+int  alive_opponents(const GameState *state);
+void send_player_choice(int sockfd, int choice, int target);
 void trim_newline(char *str);
 
-int main() {
+int main(int argc, char *argv[]) {
+    // Optional: --tls CA_FILE [NAME]
+    // CA_FILE is the certificate used to verify the server; NAME identifies
+    // this client and selects the file its TLS session is saved to
+    const char *ca_file = NULL;
+    const char *client_name = NULL;
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "--tls") == 0) {
+        ca_file = argv[2];
+        client_name = (argc == 4) ? argv[3] : NULL;
+    } else if (argc != 1) {
+        fprintf(stderr, "Usage: %s [--tls CA_FILE [NAME]]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (client_name && !valid_client_name(client_name)) {
+        fprintf(stderr, "Client name must be 1-%d letters, digits, '-' or '_'.\n", MAX_NAME_LEN);
+        exit(EXIT_FAILURE);
+    }
+#ifndef USE_TLS
+    if (ca_file) {
+        fprintf(stderr, "This client was built without TLS support. Rebuild with 'make TLS=1'.\n");
+        exit(EXIT_FAILURE);
+    }
+#else
+    if (client_name) {
+        snprintf(tls_session_file, sizeof(tls_session_file), "client_session_%s.pem", client_name);
+    }
+#endif
+
     // Connect to the server
     int sockfd = connect_to_server();
     if (sockfd < 0) {
@@ -52,6 +121,14 @@ int main() {
         exit(EXIT_FAILURE);
     }
 
+#ifdef USE_TLS
+    if (ca_file && setup_tls(sockfd, ca_file) < 0) {
+        fprintf(stderr, "TLS handshake with the server failed.\n");
+        close(sockfd);
+        exit(EXIT_FAILURE);
+    }
+#endif
+
     printf("Connected to the server at %s:%d\n", SERVER_IP, SERVER_PORT);
 
     GameState game_state;
@@ -66,7 +143,7 @@ int main() {
         if (game_state.player.health <= 0) {
             printf("You have been defeated! Game Over.\n");
             break;
-        } else if (game_state.opponent.health <= 0) {
+        } else if (alive_opponents(&game_state) == 0) {
             printf("Congratulations! You have won the game.\n");
             break;
         }
@@ -74,12 +151,23 @@ int main() {
         // If it's the player's turn, prompt for action
         if (game_state.your_turn) {
             int choice = get_player_choice(&game_state);
-            send_player_choice(sockfd, choice);
+            int target = 0;
+            if (strcmp(game_state.player.hand[choice - 1].type, "Attack") == 0) {
+                target = get_target_choice(&game_state);
+            }
+            send_player_choice(sockfd, choice, target);
         } else {
-            printf("Waiting for opponent's move...\n");
+            printf("Waiting for Player %d's move...\n", game_state.current_turn + 1);
             sleep(1);
         }
     }
+#ifdef USE_TLS
+    if (tls_conn) {
+        SSL_shutdown(tls_conn);
+        SSL_CTX_free(SSL_get_SSL_CTX(tls_conn));
+        SSL_free(tls_conn);
+    }
+#endif
     close(sockfd);
     printf("Disconnected from server. Exiting.\n");
     return 0;
@@ -117,13 +205,169 @@ int connect_to_server() {
     return sockfd;
 }
 
-// Function to receive a complete message from the server
+// Client names end up in a file name, so only allow a safe set of characters
+int valid_client_name(const char *name) {
+    size_t len = strlen(name);
+    if (len == 0 || len > MAX_NAME_LEN) {
+        return 0;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (!isalnum((unsigned char)name[i]) && name[i] != '-' && name[i] != '_') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+#ifdef USE_TLS
+// Perform the TLS handshake, offering this client's saved session if any
+int setup_tls(int sockfd, const char *ca_file) {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    if (!ctx) {
+        ERR_print_errors_fp(stderr);
+        return -1;
+    }
+
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_options(ctx, TLS_CTX_OPTIONS);
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+    if (SSL_CTX_load_verify_locations(ctx, ca_file, NULL) != 1) {
+        fprintf(stderr, "Failed to load CA file '%s'\n", ca_file);
+        ERR_print_errors_fp(stderr);
+        SSL_CTX_free(ctx);
+        return -1;
+    }
+
+    // Save every new session (TLS 1.3 tickets arrive after the handshake)
+    if (tls_session_file[0]) {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx, save_session);
+    }
+
+    SSL *ssl = SSL_new(ctx);
+    if (!ssl || SSL_set_fd(ssl, sockfd) != 1) {
+        ERR_print_errors_fp(stderr);
+        SSL_free(ssl);
+        SSL_CTX_free(ctx);
+        return -1;
+    }
+
+    // The server certificate must be issued for the address we connect to
+    X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), SERVER_IP);
+
+    // Offer the session saved by this client last time, if any
+    FILE *session_file = tls_session_file[0] ? fopen(tls_session_file, "r") : NULL;
+    if (session_file) {
+        SSL_SESSION *session = PEM_read_SSL_SESSION(session_file, NULL, NULL, NULL);
+        if (session) {
+            SSL_set_session(ssl, session);
+            SSL_SESSION_free(session);
+        }
+        fclose(session_file);
+    }
+
+    if (SSL_connect(ssl) != 1) {
+        ERR_print_errors_fp(stderr);
+        SSL_free(ssl);
+        SSL_CTX_free(ctx);
+        return -1;
+    }
+
+    printf("TLS: %s (%s), session %s, kTLS send:%s recv:%s\n",
+           SSL_get_version(ssl), SSL_get_cipher(ssl),
+           SSL_session_reused(ssl) ? "resumed" : "new",
+           KTLS_SEND_ON(ssl) ? "on" : "off",
+           KTLS_RECV_ON(ssl) ? "on" : "off");
+
+    tls_conn = ssl;
+    return 0;
+}
+
+// Check whether a failed SSL_read() means the peer closed the connection.
+// OpenSSL before 3.0 reports a close without close_notify as
+// SSL_ERROR_SYSCALL with a return value of 0 and no queued error.
+int tls_closed(SSL *ssl, int ret) {
+    int err = SSL_get_error(ssl, ret);
+    return err == SSL_ERROR_ZERO_RETURN ||
+           (err == SSL_ERROR_SYSCALL && ret == 0 && ERR_peek_error() == 0);
+}
+
+// Report a failed SSL_read()/SSL_write(). errno is only meaningful for
+// SSL_ERROR_SYSCALL; otherwise the details are in OpenSSL's error queue.
+void report_tls_error(SSL *ssl, int ret, const char *what) {
+    int err = SSL_get_error(ssl, ret);
+    if (err == SSL_ERROR_SYSCALL && errno != 0) {
+        perror(what);
+    } else {
+        fprintf(stderr, "%s: TLS error %d\n", what, err);
+    }
+    ERR_print_errors_fp(stderr);
+}
+
+// Session callback: store the session so the next run can offer it.
+// The file holds the resumption secret, so it is only readable by the
+// owner, and it is written to a temporary file first so that a reader
+// never sees a half-written session.
+int save_session(SSL *ssl, SSL_SESSION *session) {
+    (void)ssl;
+    char tmp_file[sizeof(tls_session_file) + 16];
+    snprintf(tmp_file, sizeof(tmp_file), "%s.%ld.tmp", tls_session_file, (long)getpid());
+
+    int fd = open(tmp_file, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        perror("Failed to save TLS session");
+        return 0;
+    }
+    FILE *session_file = fdopen(fd, "w");
+    if (!session_file) {
+        perror("Failed to save TLS session");
+        close(fd);
+        unlink(tmp_file);
+        return 0;
+    }
+
+    int ok = PEM_write_SSL_SESSION(session_file, session);
+    if (fclose(session_file) != 0 || !ok || rename(tmp_file, tls_session_file) < 0) {
+        fprintf(stderr, "Failed to save TLS session to %s\n", tls_session_file);
+        unlink(tmp_file);
+    }
+    return 0;   // We did not keep a reference to the session
+}
+#endif
+
+// Function to receive a complete message from the server.
+// Several state updates may arrive in one recv(), so bytes after the
+// first newline are kept for the next call.
 int receive_full_message(int sockfd, char *buffer, size_t size) {
-    size_t total_received = 0;
+    static char pending[BUFFER_SIZE];
+    static size_t pending_len = 0;
     ssize_t bytes_received;
 
-    while (total_received < size - 1) {
-        bytes_received = recv(sockfd, buffer + total_received, size - 1 - total_received, 0);
+    while (1) {
+        char *newline = memchr(pending, '\n', pending_len);
+        if (newline || pending_len == sizeof(pending)) {
+            size_t msg_len = newline ? (size_t)(newline - pending) + 1 : pending_len;
+            size_t copy_len = (msg_len < size - 1) ? msg_len : size - 1;
+
+            memcpy(buffer, pending, copy_len);
+            buffer[copy_len] = '\0';
+            pending_len -= msg_len;
+            memmove(pending, pending + msg_len, pending_len);
+            return copy_len;
+        }
+
+#ifdef USE_TLS
+        if (tls_conn) {
+            errno = 0;
+            int n = SSL_read(tls_conn, pending + pending_len, (int)(sizeof(pending) - pending_len));
+            if (n <= 0 && !tls_closed(tls_conn, n)) {
+                report_tls_error(tls_conn, n, "SSL_read");
+                return -1;
+            }
+            bytes_received = (n > 0) ? n : 0;
+        } else
+#endif
+        bytes_received = recv(sockfd, pending + pending_len, sizeof(pending) - pending_len, 0);
         if (bytes_received < 0) {
             perror("recv");
             return -1;
@@ -132,14 +376,8 @@ int receive_full_message(int sockfd, char *buffer, size_t size) {
             printf("Server disconnected.\n");
             return 0;  // Let caller handle
         }
-        total_received += bytes_received;
-        if (buffer[total_received - 1] == '\n') {
-            break;
-        }
+        pending_len += bytes_received;
     }
-
-    buffer[total_received] = '\0';
-    return total_received;
 }
 
 // Function to send a complete message to the server
@@ -149,6 +387,17 @@ int send_full_message(int sockfd, const char *message) {
     ssize_t bytes_sent;
 
     while (total_sent < message_len) {
+#ifdef USE_TLS
+        if (tls_conn) {
+            errno = 0;
+            int n = SSL_write(tls_conn, message + total_sent, (int)(message_len - total_sent));
+            if (n <= 0) {
+                report_tls_error(tls_conn, n, "SSL_write");
+                return -1;
+            }
+            bytes_sent = n;
+        } else
+#endif
         bytes_sent = send(sockfd, message + total_sent, message_len - total_sent, 0);
         if (bytes_sent < 0) {
             perror("send");
@@ -178,37 +427,61 @@ void receive_game_state(int sockfd, GameState *state) {
 void parse_game_state(const char *msg, GameState *state) {
     memset(state, 0, sizeof(*state));
 
-    // 1) Find "YOUR_HEALTH:"
+    // 1) Find "PLAYERS:"
     {
-        const char *key = "YOUR_HEALTH:";
+        const char *key = "PLAYERS:";
         const char *found = strstr(msg, key);
         if (found) {
             found += strlen(key);
-            state->player.health = atoi(found);
+            state->num_players = atoi(found);
+            if (state->num_players > MAX_PLAYERS) {
+                state->num_players = MAX_PLAYERS;
+            }
         }
     }
 
-    // 2) Find "OPPONENT_HEALTH:"
+    // 2) Find "TURN:"
     {
-        const char *key = "OPPONENT_HEALTH:";
+        const char *key = "TURN:";
         const char *found = strstr(msg, key);
         if (found) {
             found += strlen(key);
-            state->opponent.health = atoi(found);
+            state->current_turn = atoi(found) - 1;
         }
     }
 
-    // 3) Find "YOUR_TURN:"
+    // 3) Find "HEALTH:" (comma-separated, one entry per player)
     {
-        const char *key = "YOUR_TURN:";
+        const char *key = "HEALTH:";
         const char *found = strstr(msg, key);
         if (found) {
             found += strlen(key);
-            state->your_turn = atoi(found);
+            for (int i = 0; i < state->num_players; i++) {
+                state->health[i] = atoi(found);
+                found = strchr(found, ',');
+                if (!found) {
+                    break;
+                }
+                found++;
+            }
         }
     }
 
-    // 4) Find "CARDS:"
+    // 4) Find "YOU:"
+    {
+        const char *key = "YOU:";
+        const char *found = strstr(msg, key);
+        if (found) {
+            found += strlen(key);
+            state->your_index = atoi(found) - 1;
+            if (state->your_index >= 0 && state->your_index < state->num_players) {
+                state->player.health = state->health[state->your_index];
+            }
+            state->your_turn = (state->current_turn == state->your_index) ? 1 : 0;
+        }
+    }
+
+    // 5) Find "CARDS:"
     {
         const char *key = "CARDS:";
         const char *found = strstr(msg, key);
@@ -268,7 +541,14 @@ void parse_game_state(const char *msg, GameState *state) {
 void display_game_state(const GameState *state) {
     printf("\n-----------------------------\n");
     printf("Your Health: %d\n", state->player.health);
-    printf("Opponent's Health: %d\n\n", state->opponent.health);
+    for (int i = 0; i < state->num_players; i++) {
+        if (i == state->your_index) {
+            continue;
+        }
+        printf("Player %d's Health: %d%s\n", i + 1, state->health[i],
+               (state->health[i] <= 0) ? " (defeated)" : "");
+    }
+    printf("\n");
 
     printf("Your Hand:\n");
     for (int i = 0; i < state->player.hand_size; i++) {
@@ -302,10 +582,52 @@ int get_player_choice(const GameState *state) {
     return choice;
 }
 
-// Send the player's chosen card to the server
-void send_player_choice(int sockfd, int choice) {
+// Count the opponents that are still in the game
+int alive_opponents(const GameState *state) {
+    int count = 0;
+    for (int i = 0; i < state->num_players; i++) {
+        if (i != state->your_index && state->health[i] > 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Prompt the player to select an opponent to attack.
+// Returns 0 when there is only one opponent left, letting the server pick it.
+int get_target_choice(const GameState *state) {
+    if (alive_opponents(state) <= 1) {
+        return 0;
+    }
+
+    int target;
+    printf("Select a player to attack: ");
+    while (1) {
+        if (scanf("%d", &target) != 1) {
+            // Clear invalid input
+            while (getchar() != '\n');
+            printf("Invalid input. Please enter a player number: ");
+            continue;
+        }
+        if (target < 1 || target > state->num_players ||
+            target - 1 == state->your_index || state->health[target - 1] <= 0) {
+            printf("Invalid target. Please select an opponent still in the game: ");
+            continue;
+        }
+        break;
+    }
+    while (getchar() != '\n');
+    return target;
+}
+
+// Send the player's chosen card (and attack target, if any) to the server
+void send_player_choice(int sockfd, int choice, int target) {
     char message[BUFFER_SIZE];
-    snprintf(message, sizeof(message), "PLAY_CARD:%d\n", choice);
+    if (target > 0) {
+        snprintf(message, sizeof(message), "PLAY_CARD:%d:%d\n", choice, target);
+    } else {
+        snprintf(message, sizeof(message), "PLAY_CARD:%d\n", choice);
+    }
 
     if (send_full_message(sockfd, message) < 0) {
         printf("Failed to send your move to the server.\n");
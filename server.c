@@ -4,14 +4,40 @@
 #include <unistd.h>         
 #include <arpa/inet.h>      
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <errno.h>
 #include <time.h>
 
+#ifdef USE_TLS
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+// kTLS and SSL_OP_IGNORE_UNEXPECTED_EOF need OpenSSL 3.0. Older versions
+// (1.1.1) still work, but OpenSSL then always encrypts records itself.
+#ifdef SSL_OP_ENABLE_KTLS
+#define TLS_CTX_OPTIONS   (SSL_OP_ENABLE_KTLS | SSL_OP_IGNORE_UNEXPECTED_EOF)
+#define KTLS_SEND_ON(ssl) BIO_get_ktls_send(SSL_get_wbio(ssl))
+#define KTLS_RECV_ON(ssl) BIO_get_ktls_recv(SSL_get_rbio(ssl))
+#else
+#define TLS_CTX_OPTIONS   0
+#define KTLS_SEND_ON(ssl) 0
+#define KTLS_RECV_ON(ssl) 0
+#endif
+#endif
+
 #define SERVER_PORT 12345          
 #define BUFFER_SIZE 1024
 #define MAX_CARDS 5
-#define MAX_PLAYERS 2
+#define MAX_PLAYERS 8              // Upper bound on players in one game
+#define DEFAULT_PLAYERS 2
+#define MAX_HEALTH 20
+#define TLS_HANDSHAKE_TIMEOUT 5    // Seconds a new player gets to finish the TLS handshake
+#define TICKET_KEY_LEN 80          // Session ticket keys: 16-byte name, 32-byte HMAC key, 32-byte AES key
 
 // Structure to represent a card
 typedef struct {
@@ -23,31 +49,100 @@ typedef struct {
 // Structure to represent a player
 typedef struct {
     int sockfd;
+#ifdef USE_TLS
+    SSL *ssl;          // NULL when TLS is disabled
+#endif
     int health;
     Card hand[MAX_CARDS];
     int hand_size;
+    int defeated;      // 1 once health has reached 0
 } Player;
 
 // Structure to represent the game state
 typedef struct {
     Player players[MAX_PLAYERS];
+    int num_players;     // Number of players in this game (2..MAX_PLAYERS)
     int current_turn;    // Index of the player whose turn it is
     int game_over;
 } GameState;
 
+// Starter hands, dealt to players in rotation
+static const Card starter_decks[][MAX_CARDS] = {
+    {
+        {"Fireball",         7, "Attack"},
+        {"Shield",           5, "Defense"},
+        {"Lightning Strike", 6, "Attack"},
+        {"Heal",             4, "Defense"},
+        {"Sword Slash",      5, "Attack"},
+    },
+    {
+        {"Ice Blast",        7, "Attack"},
+        {"Barrier",          5, "Defense"},
+        {"Earthquake",       6, "Attack"},
+        {"Rejuvenate",       4, "Defense"},
+        {"Axe Chop",         5, "Attack"},
+    },
+    {
+        {"Poison Dart",      7, "Attack"},
+        {"Stone Skin",       5, "Defense"},
+        {"Tornado",          6, "Attack"},
+        {"Regenerate",       4, "Defense"},
+        {"Spear Thrust",     5, "Attack"},
+    },
+    {
+        {"Shadow Bolt",      7, "Attack"},
+        {"Ward",             5, "Defense"},
+        {"Meteor",           6, "Attack"},
+        {"Mend",             4, "Defense"},
+        {"Hammer Blow",      5, "Attack"},
+    },
+};
+#define NUM_STARTER_DECKS (int)(sizeof(starter_decks) / sizeof(starter_decks[0]))
+
+#ifdef USE_TLS
+// Shared by every player connection; NULL when TLS is disabled
+static SSL_CTX *tls_ctx = NULL;
+#endif
+
 // Function prototypes
-int  setup_server();
+void parse_args(int argc, char *argv[], int *num_players,
+                const char **cert_file, const char **key_file, const char **ticket_file);
+int  setup_server(int backlog);
+#ifdef USE_TLS
+SSL_CTX *setup_tls(const char *cert_file, const char *key_file, const char *ticket_file);
+int  load_ticket_keys(SSL_CTX *ctx, const char *ticket_file);
+int  accept_tls(Player *player, FILE *log_file, int player_number);
+void set_socket_timeout(int sockfd, int seconds);
+int  tls_closed(SSL *ssl, int ret);
+void report_tls_error(SSL *ssl, int ret, const char *what);
+#endif
+ssize_t player_recv(Player *player, char *buffer, size_t size);
+ssize_t player_sendv(Player *player, struct iovec *iov, int iovcnt);
+void close_player(Player *player);
 void accept_players(int server_sockfd, GameState *game_state, FILE *log_file);
 void initialize_game(GameState *game_state);
-void send_game_state(Player *player, GameState *game_state);
+size_t encode_public_state(const GameState *game_state, char *buffer, size_t size);
+void send_game_state(Player *player, GameState *game_state, const char *public_state, size_t public_len);
 void handle_player_move(GameState *game_state, int player_index, const char *message, FILE *log_file);
+int  default_target(const GameState *game_state, int player_index);
+int  next_turn(const GameState *game_state);
 void broadcast_game_state(GameState *game_state);
 void remove_newline(char *str);
 
 // Logging helper
 void write_action_log(FILE *log_file, const char *format, ...);
 
-int main() {
+int main(int argc, char *argv[]) {
+    int num_players;
+    const char *cert_file = NULL, *key_file = NULL, *ticket_file = NULL;
+    parse_args(argc, argv, &num_players, &cert_file, &key_file, &ticket_file);
+
+#ifdef USE_TLS
+    if (cert_file) {
+        tls_ctx = setup_tls(cert_file, key_file, ticket_file);
+    }
+#endif
+
     // Open a log file in append mode
     FILE *log_file = fopen("game.log", "a");
     if (!log_file) {
@@ -63,18 +158,20 @@ int main() {
     // Initialize the game state
     GameState game_state;
     memset(&game_state, 0, sizeof(GameState));
+    game_state.num_players = num_players;
 
     // Setup server
-    int server_sockfd = setup_server();
-    printf("Server is running on port %d. Waiting for players to connect...\n", SERVER_PORT);
+    int server_sockfd = setup_server(num_players);
+    printf("Server is running on port %d%s. Waiting for %d players to connect...\n",
+           SERVER_PORT, cert_file ? " (TLS)" : "", num_players);
 
     // Accept players
     accept_players(server_sockfd, &game_state, log_file);
 
     // Initialize game
     initialize_game(&game_state);
-    printf("Both players connected. Starting the game...\n");
-    write_action_log(log_file, "Both players connected. Starting the game.\n");
+    printf("All %d players connected. Starting the game...\n", num_players);
+    write_action_log(log_file, "All %d players connected. Starting the game.\n", num_players);
 
     // Broadcast initial game state
     broadcast_game_state(&game_state);
@@ -87,14 +184,13 @@ int main() {
         memset(buffer, 0, sizeof(buffer));
 
         // Wait for the current player's move
-        ssize_t bytes_received = recv(player->sockfd, buffer, sizeof(buffer) - 1, 0);
+        ssize_t bytes_received = player_recv(player, buffer, sizeof(buffer) - 1);
         if (bytes_received <= 0) {
             // Player disconnected or error
             if (bytes_received == 0) {
                 printf("Player %d disconnected. Ending game.\n", current_player + 1);
                 write_action_log(log_file, "Player %d disconnected. Ending game.\n", current_player + 1);
             } else {
-                perror("recv");
                 write_action_log(log_file, "Error receiving from Player %d, ending game.\n", current_player + 1);
             }
             game_state.game_over = 1;
@@ -110,32 +206,59 @@ int main() {
         // Handle the player's move
         handle_player_move(&game_state, current_player, buffer, log_file);
 
-        // Check for win condition
-        for (int i = 0; i < MAX_PLAYERS; i++) {
-            if (game_state.players[i].health <= 0) {
+        // Check for newly defeated players and the win condition
+        int alive = 0, last_alive = -1;
+        for (int i = 0; i < game_state.num_players; i++) {
+            Player *p = &game_state.players[i];
+            if (p->health <= 0 && !p->defeated) {
+                p->defeated = 1;
                 printf("Player %d has been defeated!\n", i + 1);
                 write_action_log(log_file, "Player %d has been defeated!\n", i + 1);
-                game_state.game_over = 1;
-                break;
             }
+            if (!p->defeated) {
+                alive++;
+                last_alive = i;
+            }
+        }
+        if (alive <= 1) {
+            if (last_alive >= 0) {
+                printf("Player %d wins the game!\n", last_alive + 1);
+                write_action_log(log_file, "Player %d wins the game!\n", last_alive + 1);
+            }
+            game_state.game_over = 1;
         }
 
         if (!game_state.game_over) {
-            // Switch turn to the other player
-            game_state.current_turn = (game_state.current_turn + 1) % MAX_PLAYERS;
+            // Pass the turn to the next player still in the game
+            game_state.current_turn = next_turn(&game_state);
             // Broadcast updated game state
             broadcast_game_state(&game_state);
+
+            // Defeated players have seen their final state; drop them
+            for (int i = 0; i < game_state.num_players; i++) {
+                Player *p = &game_state.players[i];
+                if (p->defeated && p->sockfd >= 0) {
+                    close_player(p);
+                }
+            }
         }
     }
 
-    // Send final game state to both players
+    // Send final game state to all remaining players
     broadcast_game_state(&game_state);
 
     // Close all sockets
-    for (int i = 0; i < MAX_PLAYERS; i++) {
-        close(game_state.players[i].sockfd);
+    for (int i = 0; i < game_state.num_players; i++) {
+        if (game_state.players[i].sockfd >= 0) {
+            close_player(&game_state.players[i]);
+        }
     }
     close(server_sockfd);
+#ifdef USE_TLS
+    if (tls_ctx) {
+        SSL_CTX_free(tls_ctx);
+    }
+#endif
 
     // Log server shutdown
     time_t end_time = time(NULL);
@@ -147,8 +270,49 @@ int main() {
     return 0;
 }
 
+// Parse the command line:
+// [num_players] [--tls CERT_FILE KEY_FILE [--tls-tickets TICKET_KEY_FILE]]
+void parse_args(int argc, char *argv[], int *num_players,
+                const char **cert_file, const char **key_file, const char **ticket_file) {
+    *num_players = DEFAULT_PLAYERS;
+    *cert_file = NULL;
+    *key_file = NULL;
+    *ticket_file = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--tls") == 0 && i + 2 < argc) {
+#ifndef USE_TLS
+            fprintf(stderr, "This server was built without TLS support. Rebuild with 'make TLS=1'.\n");
+            exit(EXIT_FAILURE);
+#endif
+            *cert_file = argv[++i];
+            *key_file  = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--tls-tickets") == 0 && i + 1 < argc) {
+            *ticket_file = argv[++i];
+            continue;
+        }
+
+        char *end;
+        long n = strtol(argv[i], &end, 10);
+        if (*end != '\0' || n < 2 || n > MAX_PLAYERS) {
+            fprintf(stderr, "Usage: %s [num_players (2-%d)] "
+                    "[--tls CERT_FILE KEY_FILE [--tls-tickets TICKET_KEY_FILE]]\n",
+                    argv[0], MAX_PLAYERS);
+            exit(EXIT_FAILURE);
+        }
+        *num_players = (int)n;
+    }
+
+    if (*ticket_file && !*cert_file) {
+        fprintf(stderr, "--tls-tickets requires --tls.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
 // Set up the server socket
-int setup_server() {
+int setup_server(int backlog) {
     int sockfd;
     struct sockaddr_in server_addr;
 
@@ -179,7 +343,7 @@ int setup_server() {
     }
 
     // Start listening
-    if (listen(sockfd, MAX_PLAYERS) < 0) {
+    if (listen(sockfd, backlog) < 0) {
         perror("Listen failed");
         close(sockfd);
         exit(EXIT_FAILURE);
@@ -193,7 +357,7 @@ void accept_players(int server_sockfd, GameState *game_state, FILE *log_file) {
     struct sockaddr_in client_addr;
     socklen_t addr_len = sizeof(client_addr);
 
-    for (int i = 0; i < MAX_PLAYERS; i++) {
+    for (int i = 0; i < game_state->num_players; i++) {
         int new_sockfd = accept(server_sockfd, (struct sockaddr *)&client_addr, &addr_len);
         if (new_sockfd < 0) {
             perror("Accept failed");
@@ -201,7 +365,15 @@ void accept_players(int server_sockfd, GameState *game_state, FILE *log_file) {
             continue;
         }
         game_state->players[i].sockfd = new_sockfd;
-        game_state->players[i].health = 20;
+        game_state->players[i].health = MAX_HEALTH;
+
+#ifdef USE_TLS
+        if (tls_ctx && accept_tls(&game_state->players[i], log_file, i + 1) < 0) {
+            close(new_sockfd);
+            i--;
+            continue;
+        }
+#endif
 
         printf("Player %d connected from %s:%d\n", i + 1,
                inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
@@ -209,52 +381,10 @@ void accept_players(int server_sockfd, GameState *game_state, FILE *log_file) {
                          "Player %d connected from %s:%d\n", 
                          i + 1, inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
 
-        // Initialize player's hand
-        if (i == 0) { // Player 1
-            strcpy(game_state->players[i].hand[0].name, "Fireball");
-            strcpy(game_state->players[i].hand[0].type, "Attack");
-            game_state->players[i].hand[0].power = 7;
-
-            strcpy(game_state->players[i].hand[1].name, "Shield");
-            strcpy(game_state->players[i].hand[1].type, "Defense");
-            game_state->players[i].hand[1].power = 5;
-
-            strcpy(game_state->players[i].hand[2].name, "Lightning Strike");
-            strcpy(game_state->players[i].hand[2].type, "Attack");
-            game_state->players[i].hand[2].power = 6;
-
-            strcpy(game_state->players[i].hand[3].name, "Heal");
-            strcpy(game_state->players[i].hand[3].type, "Defense");
-            game_state->players[i].hand[3].power = 4;
-
-            strcpy(game_state->players[i].hand[4].name, "Sword Slash");
-            strcpy(game_state->players[i].hand[4].type, "Attack");
-            game_state->players[i].hand[4].power = 5;
-
-            game_state->players[i].hand_size = MAX_CARDS;
-        } else { // Player 2
-            strcpy(game_state->players[i].hand[0].name, "Ice Blast");
-            strcpy(game_state->players[i].hand[0].type, "Attack");
-            game_state->players[i].hand[0].power = 7;
-
-            strcpy(game_state->players[i].hand[1].name, "Barrier");
-            strcpy(game_state->players[i].hand[1].type, "Defense");
-            game_state->players[i].hand[1].power = 5;
-
-            strcpy(game_state->players[i].hand[2].name, "Earthquake");
-            strcpy(game_state->players[i].hand[2].type, "Attack");
-            game_state->players[i].hand[2].power = 6;
-
-            strcpy(game_state->players[i].hand[3].name, "Rejuvenate");
-            strcpy(game_state->players[i].hand[3].type, "Defense");
-            game_state->players[i].hand[3].power = 4;
-
-            strcpy(game_state->players[i].hand[4].name, "Axe Chop");
-            strcpy(game_state->players[i].hand[4].type, "Attack");
-            game_state->players[i].hand[4].power = 5;
-
-            game_state->players[i].hand_size = MAX_CARDS;
-        }
+        // Initialize player's hand from the starter decks
+        memcpy(game_state->players[i].hand, starter_decks[i % NUM_STARTER_DECKS],
+               sizeof(game_state->players[i].hand));
+        game_state->players[i].hand_size = MAX_CARDS;
     }
 
     // Set the starting player (Player 1)
@@ -266,40 +396,60 @@ void accept_players(int server_sockfd, GameState *game_state, FILE *log_file) {
 void initialize_game(GameState *game_state) {
 }
 
+// Encode the state shared by all players. This is built once per turn and
+// sent unchanged to everyone, so only the hand is encoded per player.
+size_t encode_public_state(const GameState *game_state, char *buffer, size_t size) {
+    size_t len = (size_t)snprintf(buffer, size, "PLAYERS:%d;TURN:%d;HEALTH:",
+                                  game_state->num_players, game_state->current_turn + 1);
+
+    for (int i = 0; i < game_state->num_players && len < size; i++) {
+        len += (size_t)snprintf(buffer + len, size - len, "%s%d",
+                                (i > 0) ? "," : "", game_state->players[i].health);
+    }
+    if (len < size) {
+        len += (size_t)snprintf(buffer + len, size - len, ";");
+    }
+    return (len < size) ? len : size - 1;
+}
+
 // Send the current game state to a specific player
-void send_game_state(Player *player, GameState *game_state) {
+void send_game_state(Player *player, GameState *game_state, const char *public_state, size_t public_len) {
+    if (player->sockfd < 0) {
+        return;
+    }
+
     char message[BUFFER_SIZE];
-    memset(message, 0, sizeof(message));
+    size_t len;
 
-    // Calculate player index and opponent index
-    int player_index   = (int)(player - game_state->players);  
-    int opponent_index = 1 - player_index;                    
+    // Calculate player index
+    int player_index = (int)(player - game_state->players);
 
-    // Construct the message
-    snprintf(message, sizeof(message),
-             "YOUR_HEALTH:%d;OPPONENT_HEALTH:%d;YOUR_TURN:%d;CARDS:",
-             player->health,
-             game_state->players[opponent_index].health,
-             (game_state->current_turn == player_index) ? 1 : 0);
+    // Construct the private part of the message
+    len = (size_t)snprintf(message, sizeof(message), "YOU:%d;CARDS:", player_index + 1);
 
     // Append each card
-    for (int i = 0; i < player->hand_size; i++) {
-        char card_info[50];
-        snprintf(card_info, sizeof(card_info), "%s,%s,%d",
-                 player->hand[i].name,
-                 player->hand[i].type,
-                 player->hand[i].power);
-        strcat(message, card_info);
-        if (i < player->hand_size - 1) {
-            strcat(message, "|");
-        }
+    for (int i = 0; i < player->hand_size && len < sizeof(message); i++) {
+        len += (size_t)snprintf(message + len, sizeof(message) - len, "%s%s,%s,%d",
+                                (i > 0) ? "|" : "",
+                                player->hand[i].name,
+                                player->hand[i].type,
+                                player->hand[i].power);
     }
-    strcat(message, "\n");
-
-    // Send the message to the player
-    if (send(player->sockfd, message, strlen(message), 0) < 0) {
-        perror("send");
+    if (len < sizeof(message)) {
+        len += (size_t)snprintf(message + len, sizeof(message) - len, "\n");
+    }
+    if (len >= sizeof(message)) {
+        len = sizeof(message) - 1;
     }
+
+    // Send the shared and private parts together in one call
+    struct iovec iov[2];
+    iov[0].iov_base = (void *)public_state;
+    iov[0].iov_len  = public_len;
+    iov[1].iov_base = message;
+    iov[1].iov_len  = len;
+
+    player_sendv(player, iov, 2);
 }
 
 // Handle a player's move
@@ -310,6 +460,7 @@ void handle_player_move(GameState *game_state, int player_index, const char *mes
         return;
     }
 
+    // Format: PLAY_CARD:<card>[:<target player>]
     int card_choice = atoi(message + 10);
     if (card_choice < 1 || card_choice > game_state->players[player_index].hand_size) {
         printf("Player %d selected an invalid card: %d\n", player_index + 1, card_choice);
@@ -317,34 +468,333 @@ void handle_player_move(GameState *game_state, int player_index, const char *mes
         return;
     }
 
-    // Retrieve the selected card
     Card *selected_card = &game_state->players[player_index].hand[card_choice - 1];
-    printf("Player %d played %s (%s, Power: %d)\n",
-           player_index + 1, selected_card->name, selected_card->type, selected_card->power);
-    write_action_log(log_file, 
-                     "Player %d played %s (%s, Power: %d)\n",
-                     player_index + 1, selected_card->name, selected_card->type, selected_card->power);
-
-    // Apply the card's effect to the opponent or self
-    int opponent_index = 1 - player_index;
-    if (strcmp(selected_card->type, "Attack") == 0) {
-        game_state->players[opponent_index].health -= selected_card->power;
-        if (game_state->players[opponent_index].health < 0) {
-            game_state->players[opponent_index].health = 0;
+    int is_attack = (strcmp(selected_card->type, "Attack") == 0);
+
+    // Resolve the attack target; without one, attack the next player in turn order
+    int target_index = -1;
+    if (is_attack) {
+        const char *target_str = strchr(message + 10, ':');
+        target_index = target_str ? atoi(target_str + 1) - 1
+                                  : default_target(game_state, player_index);
+        if (target_index < 0 || target_index >= game_state->num_players ||
+            target_index == player_index || game_state->players[target_index].defeated) {
+            printf("Player %d selected an invalid target: %s\n", player_index + 1, message);
+            write_action_log(log_file, "Player %d selected an invalid target: %s\n", player_index + 1, message);
+            return;
+        }
+    }
+
+    // Log the played card
+    if (is_attack) {
+        printf("Player %d played %s (%s, Power: %d) on Player %d\n",
+               player_index + 1, selected_card->name, selected_card->type, selected_card->power,
+               target_index + 1);
+        write_action_log(log_file, 
+                         "Player %d played %s (%s, Power: %d) on Player %d\n",
+                         player_index + 1, selected_card->name, selected_card->type, selected_card->power,
+                         target_index + 1);
+    } else {
+        printf("Player %d played %s (%s, Power: %d)\n",
+               player_index + 1, selected_card->name, selected_card->type, selected_card->power);
+        write_action_log(log_file, 
+                         "Player %d played %s (%s, Power: %d)\n",
+                         player_index + 1, selected_card->name, selected_card->type, selected_card->power);
+    }
+
+    // Apply the card's effect to the target or self
+    if (is_attack) {
+        game_state->players[target_index].health -= selected_card->power;
+        if (game_state->players[target_index].health < 0) {
+            game_state->players[target_index].health = 0;
         }
     } else if (strcmp(selected_card->type, "Defense") == 0) {
         game_state->players[player_index].health += selected_card->power;
-        if (game_state->players[player_index].health > 20) { // Max health
-            game_state->players[player_index].health = 20;
+        if (game_state->players[player_index].health > MAX_HEALTH) {
+            game_state->players[player_index].health = MAX_HEALTH;
         }
     }
     selected_card->power -= 1;
 }
 
+// First player after player_index (in turn order) who is still in the game
+int default_target(const GameState *game_state, int player_index) {
+    for (int step = 1; step < game_state->num_players; step++) {
+        int i = (player_index + step) % game_state->num_players;
+        if (!game_state->players[i].defeated) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Index of the player who moves after the current one
+int next_turn(const GameState *game_state) {
+    int next = default_target(game_state, game_state->current_turn);
+    return (next >= 0) ? next : game_state->current_turn;
+}
+
+#ifdef USE_TLS
+// Create the TLS context shared by all player connections
+SSL_CTX *setup_tls(const char *cert_file, const char *key_file, const char *ticket_file) {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) {
+        ERR_print_errors_fp(stderr);
+        exit(EXIT_FAILURE);
+    }
+
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+
+    // Let the kernel take over record encryption after the handshake (kTLS),
+    // and treat a peer closing without close_notify as a normal disconnect
+    SSL_CTX_set_options(ctx, TLS_CTX_OPTIONS);
+
+    // Session resumption: cache sessions and issue tickets so reconnecting
+    // clients can skip the full handshake. The server exits after each game,
+    // so tickets only survive into the next game with persistent ticket keys.
+    static const unsigned char session_id_ctx[] = "card-game";
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_set_session_id_context(ctx, session_id_ctx, sizeof(session_id_ctx) - 1);
+    if (ticket_file && load_ticket_keys(ctx, ticket_file) < 0) {
+        SSL_CTX_free(ctx);
+        exit(EXIT_FAILURE);
+    }
+
+    if (SSL_CTX_use_certificate_chain_file(ctx, cert_file) <= 0 ||
+        SSL_CTX_use_PrivateKey_file(ctx, key_file, SSL_FILETYPE_PEM) <= 0 ||
+        SSL_CTX_check_private_key(ctx) <= 0) {
+        fprintf(stderr, "Failed to load TLS certificate '%s' / key '%s'\n", cert_file, key_file);
+        ERR_print_errors_fp(stderr);
+        SSL_CTX_free(ctx);
+        exit(EXIT_FAILURE);
+    }
+
+    // SSL_write() to a player that already left must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    return ctx;
+}
+
+// Load the session ticket keys from a file, so that tickets issued by an
+// earlier server process can still be decrypted. The file holds secrets and
+// must not be accessible to group or others.
+int load_ticket_keys(SSL_CTX *ctx, const char *ticket_file) {
+    unsigned char keys[TICKET_KEY_LEN];
+    struct stat st;
+
+    int fd = open(ticket_file, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open ticket key file");
+        return -1;
+    }
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || (st.st_mode & 077) != 0) {
+        fprintf(stderr, "Ticket key file '%s' must be a regular file with mode 0600\n", ticket_file);
+        close(fd);
+        return -1;
+    }
+
+    ssize_t bytes_read = read(fd, keys, sizeof(keys));
+    char extra;
+    if (bytes_read != (ssize_t)sizeof(keys) || read(fd, &extra, 1) != 0) {
+        fprintf(stderr, "Ticket key file '%s' must contain exactly %d bytes\n", ticket_file, TICKET_KEY_LEN);
+        close(fd);
+        OPENSSL_cleanse(keys, sizeof(keys));
+        return -1;
+    }
+    close(fd);
+
+    long ok = SSL_CTX_set_tlsext_ticket_keys(ctx, keys, sizeof(keys));
+    OPENSSL_cleanse(keys, sizeof(keys));
+    if (ok != 1) {
+        fprintf(stderr, "Failed to set ticket keys from '%s'\n", ticket_file);
+        ERR_print_errors_fp(stderr);
+        return -1;
+    }
+    return 0;
+}
+
+// Perform the TLS handshake on a newly accepted player socket.
+// A peer that stalls (or does not speak TLS) is dropped after
+// TLS_HANDSHAKE_TIMEOUT seconds instead of blocking the whole lobby.
+int accept_tls(Player *player, FILE *log_file, int player_number) {
+    set_socket_timeout(player->sockfd, TLS_HANDSHAKE_TIMEOUT);
+
+    player->ssl = SSL_new(tls_ctx);
+    if (!player->ssl || SSL_set_fd(player->ssl, player->sockfd) != 1 ||
+        SSL_accept(player->ssl) != 1) {
+        fprintf(stderr, "TLS handshake with Player %d failed\n", player_number);
+        ERR_print_errors_fp(stderr);
+        write_action_log(log_file, "TLS handshake with Player %d failed\n", player_number);
+        SSL_free(player->ssl);
+        player->ssl = NULL;
+        return -1;
+    }
+
+    // The game itself waits on players for as long as they need
+    set_socket_timeout(player->sockfd, 0);
+
+    int ktls_send = KTLS_SEND_ON(player->ssl);
+    int ktls_recv = KTLS_RECV_ON(player->ssl);
+    printf("Player %d: %s (%s), session %s, kTLS send:%s recv:%s\n", player_number,
+           SSL_get_version(player->ssl), SSL_get_cipher(player->ssl),
+           SSL_session_reused(player->ssl) ? "resumed" : "new",
+           ktls_send ? "on" : "off", ktls_recv ? "on" : "off");
+    write_action_log(log_file, "Player %d: %s (%s), session %s, kTLS send:%s recv:%s\n", player_number,
+                     SSL_get_version(player->ssl), SSL_get_cipher(player->ssl),
+                     SSL_session_reused(player->ssl) ? "resumed" : "new",
+                     ktls_send ? "on" : "off", ktls_recv ? "on" : "off");
+    return 0;
+}
+
+// Check whether a failed SSL_read() means the peer closed the connection.
+// OpenSSL before 3.0 reports a close without close_notify as
+// SSL_ERROR_SYSCALL with a return value of 0 and no queued error.
+int tls_closed(SSL *ssl, int ret) {
+    int err = SSL_get_error(ssl, ret);
+    return err == SSL_ERROR_ZERO_RETURN ||
+           (err == SSL_ERROR_SYSCALL && ret == 0 && ERR_peek_error() == 0);
+}
+
+// Report a failed SSL_read()/SSL_write(). errno is only meaningful for
+// SSL_ERROR_SYSCALL; otherwise the details are in OpenSSL's error queue.
+void report_tls_error(SSL *ssl, int ret, const char *what) {
+    int err = SSL_get_error(ssl, ret);
+    if (err == SSL_ERROR_SYSCALL && errno != 0) {
+        perror(what);
+    } else {
+        fprintf(stderr, "%s: TLS error %d\n", what, err);
+    }
+    ERR_print_errors_fp(stderr);
+}
+
+// Set the receive and send timeouts of a socket (0 = no timeout)
+void set_socket_timeout(int sockfd, int seconds) {
+    struct timeval tv;
+    tv.tv_sec  = seconds;
+    tv.tv_usec = 0;
+
+    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0 ||
+        setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) < 0) {
+        perror("setsockopt");
+    }
+}
+#endif
+
+// Receive data from a player, decrypting it when TLS is enabled.
+// Errors are reported here; 0 means the player disconnected.
+ssize_t player_recv(Player *player, char *buffer, size_t size) {
+#ifdef USE_TLS
+    if (player->ssl) {
+        // Always go through OpenSSL: even with kTLS receive enabled it has to
+        // handle non-data records such as session tickets and key updates
+        errno = 0;
+        int n = SSL_read(player->ssl, buffer, (int)size);
+        if (n > 0) {
+            return n;
+        }
+        if (tls_closed(player->ssl, n)) {
+            return 0;
+        }
+        report_tls_error(player->ssl, n, "SSL_read");
+        return -1;
+    }
+#endif
+    ssize_t bytes_received = recv(player->sockfd, buffer, size, 0);
+    if (bytes_received < 0) {
+        perror("recv");
+    }
+    return bytes_received;
+}
+
+// Send a message made of several buffers to a player, gathering them into
+// one sendmsg() call. Short writes are resumed, so iov is modified.
+// Errors are reported here.
+ssize_t player_sendv(Player *player, struct iovec *iov, int iovcnt) {
+#ifdef USE_TLS
+    // With kTLS send enabled the kernel encrypts whatever is written to the
+    // socket, so the sendmsg() path below is used as-is. Otherwise the
+    // buffers are joined and encrypted by OpenSSL.
+    if (player->ssl && !KTLS_SEND_ON(player->ssl)) {
+        char joined[2 * BUFFER_SIZE];
+        size_t len = 0;
+        for (int i = 0; i < iovcnt; i++) {
+            len += iov[i].iov_len;
+        }
+        if (len > sizeof(joined)) {
+            fprintf(stderr, "SSL_write: message of %zu bytes does not fit in %zu\n",
+                    len, sizeof(joined));
+            return -1;
+        }
+
+        len = 0;
+        for (int i = 0; i < iovcnt; i++) {
+            memcpy(joined + len, iov[i].iov_base, iov[i].iov_len);
+            len += iov[i].iov_len;
+        }
+        errno = 0;
+        int n = SSL_write(player->ssl, joined, (int)len);
+        if (n <= 0) {
+            report_tls_error(player->ssl, n, "SSL_write");
+            return -1;
+        }
+        return n;
+    }
+#endif
+    ssize_t total_sent = 0;
+
+    while (iovcnt > 0) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov    = iov;
+        msg.msg_iovlen = iovcnt;
+
+        // MSG_NOSIGNAL: a player that already left must not kill the server
+        ssize_t bytes_sent = sendmsg(player->sockfd, &msg, MSG_NOSIGNAL);
+        if (bytes_sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("sendmsg");
+            return -1;
+        }
+        total_sent += bytes_sent;
+
+        // Skip the buffers that were written completely and
+        // advance into the one that was written partially
+        while (iovcnt > 0 && (size_t)bytes_sent >= iov->iov_len) {
+            bytes_sent -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + bytes_sent;
+            iov->iov_len -= bytes_sent;
+        }
+    }
+
+    return total_sent;
+}
+
+// Close a player's connection, sending a TLS close_notify first if needed
+void close_player(Player *player) {
+#ifdef USE_TLS
+    if (player->ssl) {
+        SSL_shutdown(player->ssl);
+        SSL_free(player->ssl);
+        player->ssl = NULL;
+    }
+#endif
+    close(player->sockfd);
+    player->sockfd = -1;
+}
+
 // Broadcast the game state to all players
 void broadcast_game_state(GameState *game_state) {
-    for (int i = 0; i < MAX_PLAYERS; i++) {
-        send_game_state(&game_state->players[i], game_state);
+    char public_state[BUFFER_SIZE];
+    size_t public_len = encode_public_state(game_state, public_state, sizeof(public_state));
+
+    for (int i = 0; i < game_state->num_players; i++) {
+        send_game_state(&game_state->players[i], game_state, public_state, public_len);
     }
 }
 